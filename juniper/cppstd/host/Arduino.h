@@ -0,0 +1,634 @@
+#ifndef JUNIPER_HOST_ARDUINO_H
+#define JUNIPER_HOST_ARDUINO_H
+
+// Host stand-in for the Arduino core. Putting this directory on the include
+// path lets a generated sketch build and run natively, for example:
+//
+//     g++ -std=c++11 -I juniper/cppstd/host sketch.cpp -o sketch -lpthread
+//
+// Pins are simulated in memory. Test harnesses can drive input pins with
+// juniper_host::setPin or a juniper_host::pinProducer thread, which fires any
+// attached interrupt handlers from that thread just like hardware would.
+// Define JUNIPER_HOST_NO_MAIN to supply your own main().
+//
+// Pins are grouped into simulated 8-bit ports (pin p is bit p % 8 of port
+// p / 8) so that the runtime's port register fast path works on the host.
+// Every port read or write, including each digitalRead and digitalWrite, is
+// counted in juniper_host::portAccesses; JUNIPER_HOST_PORT_STATS=1 prints
+// the count on exit.
+//
+// Analog inputs read their pin's analogValue, or a waveform: either a
+// function of time set with juniper_host::setWaveform, or a file of sample
+// values played back one per read, loaded with juniper_host::loadWaveform or
+// JUNIPER_HOST_ANALOG_IN=<pin>:<path>. Continuous ADC sampling evaluates the
+// waveform at the scheduled time of every sample.
+//
+// Time comes from the host's steady clock by default. With the virtual clock
+// enabled (juniper_host::useVirtualClock, or JUNIPER_HOST_VIRTUAL_CLOCK=1 in
+// the environment) time only moves when the sketch calls delay() or when the
+// main loop fast-forwards to the earliest deadline noted by the timers, so a
+// day of simulated time runs in seconds and every run is deterministic.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define PROGMEM
+
+#define LOW 0
+#define HIGH 1
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+const uint8_t A0 = 14;
+const uint8_t A1 = 15;
+const uint8_t A2 = 16;
+const uint8_t A3 = 17;
+const uint8_t A4 = 18;
+const uint8_t A5 = 19;
+const uint8_t A6 = 20;
+const uint8_t A7 = 21;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+void setup();
+void loop();
+
+namespace juniper_host {
+    const uint16_t numPins = 64;
+
+    struct pin {
+        std::atomic<uint8_t> level;
+        std::atomic<uint16_t> analogValue;
+        uint8_t mode;
+        int interruptMode;
+        void (*isr)();
+    };
+
+    pin pins[numPins];
+
+    uint64_t portAccesses = 0;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    bool virtualClock = false;
+    std::atomic<uint64_t> virtualMicros(0);
+
+    void useVirtualClock(bool enable) {
+        virtualClock = enable;
+    }
+
+    uint64_t clockMicros() {
+        if (virtualClock) {
+            return virtualMicros.load();
+        }
+        return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+
+    void sleepMicros(uint64_t us) {
+        if (virtualClock) {
+            virtualMicros += us;
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(us));
+        }
+    }
+
+    // Sets the level of a pin as if it were driven externally, firing the
+    // pin's interrupt handler on the calling thread if the edge matches.
+    void setPin(uint16_t p, uint8_t value) {
+        if (p >= numPins) {
+            return;
+        }
+        uint8_t prev = pins[p].level.exchange(value);
+        void (*isr)() = pins[p].isr;
+        if (isr == nullptr || prev == value) {
+            return;
+        }
+        int m = pins[p].interruptMode;
+        if (m == CHANGE || (m == RISING && value == HIGH) || (m == FALLING && value == LOW)) {
+            isr();
+        }
+    }
+
+    struct waveform {
+        double (*function)(double seconds);
+        uint16_t* values;
+        size_t count;
+        size_t next;
+    };
+
+    waveform waveforms[numPins];
+
+    // Makes analog reads of a pin return f(t) for the time t in seconds,
+    // clamped to the 10-bit range of the ADC.
+    void setWaveform(uint16_t p, double (*f)(double seconds)) {
+        if (p < numPins) {
+            waveforms[p].function = f;
+        }
+    }
+
+    // Makes analog reads of a pin play back the whitespace separated values
+    // in a file, starting over at the end. Returns false if the file cannot
+    // be read or holds no values.
+    bool loadWaveform(uint16_t p, const char* path) {
+        FILE* file = p < numPins ? fopen(path, "r") : nullptr;
+        if (file == nullptr) {
+            return false;
+        }
+        size_t capacity = 256;
+        size_t count = 0;
+        uint16_t* values = (uint16_t*) malloc(capacity * sizeof(uint16_t));
+        unsigned value;
+        while (fscanf(file, "%u", &value) == 1) {
+            if (count == capacity) {
+                capacity *= 2;
+                values = (uint16_t*) realloc(values, capacity * sizeof(uint16_t));
+            }
+            values[count++] = (uint16_t) (value > 1023 ? 1023 : value);
+        }
+        fclose(file);
+        if (count == 0) {
+            free(values);
+            return false;
+        }
+        free(waveforms[p].values);
+        waveforms[p].values = values;
+        waveforms[p].count = count;
+        waveforms[p].next = 0;
+        return true;
+    }
+
+    bool hasWaveform(uint16_t p) {
+        return p < numPins && (waveforms[p].function != nullptr || waveforms[p].values != nullptr);
+    }
+
+    uint16_t waveformAt(uint16_t p, uint64_t atMicros) {
+        waveform& w = waveforms[p];
+        if (w.values != nullptr) {
+            uint16_t value = w.values[w.next];
+            w.next = (w.next + 1) % w.count;
+            return value;
+        }
+        double value = w.function(atMicros / 1e6);
+        return (uint16_t) (value < 0 ? 0 : value > 1023 ? 1023 : value + 0.5);
+    }
+
+    // Producer thread which toggles an input pin a fixed number of times with
+    // the given period, simulating an external signal source.
+    class pinProducer {
+    public:
+        pinProducer(uint16_t p, uint32_t periodMicros, uint32_t toggles)
+            : thread_([=]() {
+                for (uint32_t i = 0; i < toggles; i++) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(periodMicros));
+                    setPin(p, pins[p].level.load() == LOW ? HIGH : LOW);
+                }
+            }) { }
+
+        ~pinProducer() {
+            thread_.join();
+        }
+
+    private:
+        std::thread thread_;
+    };
+}
+
+inline void init() { }
+
+inline unsigned long micros() {
+    return (unsigned long) juniper_host::clockMicros();
+}
+
+inline unsigned long millis() {
+    return (unsigned long) (juniper_host::clockMicros() / 1000);
+}
+
+inline void delay(unsigned long ms) {
+    juniper_host::sleepMicros((uint64_t) ms * 1000);
+}
+
+inline void delayMicroseconds(unsigned int us) {
+    juniper_host::sleepMicros(us);
+}
+
+#ifdef JUNIPER_H
+namespace juniper_host {
+    // Moves the virtual clock to the earliest deadline noted during the last
+    // loop iteration, or on by one millisecond if nothing is pending.
+    void fastForward() {
+        uint32_t now = (uint32_t) millis();
+        uint32_t step = 1;
+        if (juniper::deadlines::pending && !juniper::time_reached(now, juniper::deadlines::earliest)) {
+            step = juniper::deadlines::earliest - now;
+        }
+        virtualMicros = (virtualMicros.load() / 1000 + step) * 1000;
+        juniper::deadlines::reset();
+    }
+
+    // Models the low-power wait in Time:idle. With the virtual clock the wait
+    // skips straight to the deadline. Otherwise it sleeps in short slices, so
+    // a pin interrupt from a producer thread can still end the wait early.
+    void idleWait(uint32_t deadline) {
+        uint32_t now = (uint32_t) millis();
+        if (juniper::power::woken || juniper::time_reached(now, deadline)) {
+            return;
+        }
+        if (virtualClock) {
+            virtualMicros = (virtualMicros.load() / 1000 + (deadline - now)) * 1000;
+        }
+        else {
+            std::this_thread::sleep_for(std::chrono::microseconds(250));
+        }
+    }
+
+    struct stderrPrinter {
+        void print(const char* s) { fputs(s, stderr); }
+        void print(unsigned long n) { fprintf(stderr, "%lu", n); }
+    };
+
+    void reportProbe() {
+        if (juniper::probe::enabled) {
+            stderrPrinter out;
+            juniper::probe::report(out);
+        }
+    }
+
+    uint32_t portRegister(uint16_t p) {
+        return p < numPins ? p / 8 + 1 : 0;
+    }
+
+    uint8_t portMask(uint16_t p) {
+        return p < numPins ? (uint8_t) (1 << (p % 8)) : 0;
+    }
+
+    void writePort(uint32_t reg, uint8_t set, uint8_t clear) {
+        portAccesses++;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            pin& target = pins[(reg - 1) * 8 + bit];
+            if (set & (1 << bit)) {
+                target.level = HIGH;
+            }
+            else if (clear & (1 << bit)) {
+                target.level = LOW;
+            }
+        }
+    }
+
+    uint8_t readPort(uint32_t reg) {
+        portAccesses++;
+        uint8_t levels = 0;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (pins[(reg - 1) * 8 + bit].level.load() != LOW) {
+                levels |= (uint8_t) (1 << bit);
+            }
+        }
+        return levels;
+    }
+
+    juniper::fast_io::hooks portHooks = { portRegister, portMask, writePort, readPort };
+
+    // Installed during static initialization, so that the simulated ports
+    // are in place before setup() resolves any pins.
+    juniper::fast_io::hooks* installedPortHooks = juniper::fast_io::port_hooks = &portHooks;
+
+    uint16_t adcSample(uint16_t p, uint32_t atMicros) {
+        if (hasWaveform(p)) {
+            return waveformAt(p, atMicros);
+        }
+        return p < numPins ? pins[p].analogValue.load() : 0;
+    }
+
+    juniper::adc::read_at_fn installedAdcHook = juniper::adc::read_hook = adcSample;
+
+    void reportPorts() {
+        const char* statsEnv = getenv("JUNIPER_HOST_PORT_STATS");
+        if (statsEnv != nullptr && strcmp(statsEnv, "0") != 0) {
+            fprintf(stderr, "juniper_host: %llu port accesses\n", (unsigned long long) portAccesses);
+        }
+    }
+
+    // Sends whatever Io:bufferSerial output is still buffered at exit.
+    void drainSerial() {
+        if (juniper::serial_out::enabled) {
+            while (juniper::serial_out::flush(juniper::serial_out::capacity) > 0) {
+            }
+            if (juniper::serial_out::dropped > 0) {
+                fprintf(stderr, "juniper_host: %lu serial bytes dropped\n",
+                    (unsigned long) juniper::serial_out::dropped);
+            }
+        }
+    }
+
+    void reportIdle() {
+        if (juniper::power::idle_millis > 0) {
+            unsigned long total = millis();
+            fprintf(stderr, "juniper_host: idle %lu of %lu ms (%.1f%%)\n",
+                (unsigned long) juniper::power::idle_millis, total,
+                total == 0 ? 0.0 : 100.0 * juniper::power::idle_millis / total);
+        }
+    }
+}
+#endif
+
+inline void pinMode(uint16_t p, uint8_t m) {
+    if (p < juniper_host::numPins) {
+        juniper_host::pins[p].mode = m;
+        if (m == INPUT_PULLUP) {
+            juniper_host::pins[p].level = HIGH;
+        }
+    }
+}
+
+inline void digitalWrite(uint16_t p, uint8_t value) {
+    if (p < juniper_host::numPins) {
+        juniper_host::portAccesses++;
+        juniper_host::pins[p].level = value == LOW ? LOW : HIGH;
+    }
+}
+
+inline int digitalRead(uint16_t p) {
+    if (p >= juniper_host::numPins) {
+        return LOW;
+    }
+    juniper_host::portAccesses++;
+    return juniper_host::pins[p].level.load();
+}
+
+inline int analogRead(uint16_t p) {
+    if (juniper_host::hasWaveform(p)) {
+        return juniper_host::waveformAt(p, juniper_host::clockMicros());
+    }
+    return p < juniper_host::numPins ? juniper_host::pins[p].analogValue.load() : 0;
+}
+
+inline void analogWrite(uint16_t p, int value) {
+    if (p < juniper_host::numPins) {
+        juniper_host::pins[p].analogValue = (uint16_t) value;
+    }
+}
+
+inline int digitalPinToInterrupt(uint16_t p) {
+    return p;
+}
+
+inline void attachInterrupt(int interrupt, void (*isr)(), int m) {
+    if (interrupt >= 0 && interrupt < juniper_host::numPins) {
+        juniper_host::pins[interrupt].interruptMode = m;
+        juniper_host::pins[interrupt].isr = isr;
+    }
+}
+
+inline void detachInterrupt(int interrupt) {
+    if (interrupt >= 0 && interrupt < juniper_host::numPins) {
+        juniper_host::pins[interrupt].isr = nullptr;
+    }
+}
+
+// Formatting half of the Arduino Print class. Subclasses only provide
+// write(uint8_t), and optionally a faster write for whole buffers.
+class Print {
+public:
+    virtual ~Print() { }
+
+    virtual size_t write(uint8_t b) = 0;
+
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size-- > 0 && write(*buffer++) == 1) {
+            n++;
+        }
+        return n;
+    }
+
+    size_t write(const char* s) { return write((const uint8_t*) s, strlen(s)); }
+
+    size_t print(const char* s) { return write(s); }
+    size_t print(char c) { return write((uint8_t) c); }
+
+    size_t print(double f, int places = 2) {
+        char buf[64];
+        int len = snprintf(buf, sizeof(buf), "%.*f", places, f);
+        return write((const uint8_t*) buf, len < (int) sizeof(buf) ? len : sizeof(buf) - 1);
+    }
+
+    size_t print(long n, int base = DEC) {
+        if (base == DEC && n < 0) {
+            return print('-') + print(0UL - (unsigned long) n, base);
+        }
+        return print((unsigned long) n, base);
+    }
+
+    size_t print(unsigned long n, int base = DEC) {
+        char buf[8 * sizeof(unsigned long) + 1];
+        char* p = &buf[sizeof(buf) - 1];
+        *p = '\0';
+        if (base < 2) {
+            base = DEC;
+        }
+        do {
+            unsigned long digit = n % base;
+            n /= base;
+            *--p = (char) (digit < 10 ? '0' + digit : 'A' + digit - 10);
+        } while (n != 0);
+        return print(p);
+    }
+
+    size_t print(int n, int base = DEC) { return print((long) n, base); }
+    size_t print(unsigned int n, int base = DEC) { return print((unsigned long) n, base); }
+    size_t print(unsigned char n, int base = DEC) { return print((unsigned long) n, base); }
+
+    size_t println() { return print("\n"); }
+
+    template<typename T>
+    size_t println(T value) { return print(value) + println(); }
+
+    template<typename T>
+    size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+// Serial port backed by file descriptors: output goes to standard output
+// unless JUNIPER_HOST_SERIAL_OUT names a file, and input comes from standard
+// input unless JUNIPER_HOST_SERIAL_IN names a file. Like the receive buffer
+// of a real UART, input never blocks: available() only reports bytes which
+// can be read right away.
+class HostSerial : public Print {
+public:
+    using Print::write;
+
+    void begin(unsigned long) { }
+
+    int available() {
+        if (rxStart_ == rxEnd_ && !rxEof_) {
+            pollfd p = { rxFd_, POLLIN, 0 };
+            if (poll(&p, 1, 0) > 0) {
+                ssize_t n = ::read(rxFd_, rx_, sizeof(rx_));
+                rxStart_ = 0;
+                rxEnd_ = n > 0 ? n : 0;
+                rxEof_ = n == 0;
+            }
+        }
+        return rxEnd_ - rxStart_;
+    }
+
+    int read() {
+        if (available() == 0) {
+            return -1;
+        }
+        bytesRead_++;
+        return rx_[rxStart_++];
+    }
+
+    int peek() {
+        return available() == 0 ? -1 : rx_[rxStart_];
+    }
+
+    // True once the input has reached end of file and been read completely.
+    bool inputDone() {
+        return available() == 0 && rxEof_;
+    }
+
+    uint64_t bytesRead() const { return bytesRead_; }
+
+    void useInputFd(int fd) { rxFd_ = fd; }
+
+    size_t write(uint8_t b) { return write(&b, 1); }
+
+    size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (n < size) {
+            ssize_t written = ::write(fd_, buffer + n, size - n);
+            if (written <= 0) {
+                break;
+            }
+            n += written;
+        }
+        return n;
+    }
+
+    void useFd(int fd) { fd_ = fd; }
+
+    // The host writes straight to a file, so the transmit buffer is always
+    // empty. Tests can shrink it to simulate a busy port.
+    int availableForWrite() { return txRoom_; }
+
+    void setTxRoom(int room) { txRoom_ = room; }
+
+    void flush() { }
+
+    operator bool() const { return true; }
+
+private:
+    int fd_ = 1;
+    int txRoom_ = 63;
+    int rxFd_ = 0;
+    uint8_t rx_[64];
+    int rxStart_ = 0;
+    int rxEnd_ = 0;
+    bool rxEof_ = false;
+    uint64_t bytesRead_ = 0;
+};
+
+HostSerial Serial;
+
+#ifndef JUNIPER_HOST_NO_MAIN
+// Runs setup() and then loop() forever. JUNIPER_HOST_ITERATIONS limits the
+// number of loop iterations and JUNIPER_HOST_DURATION_MS the elapsed
+// (possibly virtual) time. JUNIPER_HOST_VIRTUAL_CLOCK=1 enables the virtual
+// clock, and JUNIPER_HOST_SERIAL_OUT redirects Serial output to a file.
+// JUNIPER_HOST_SERIAL_IN feeds Serial input from a file; the run then ends
+// once the whole file has been read, and the input rate is reported.
+int main() {
+    const char* iterationsEnv = getenv("JUNIPER_HOST_ITERATIONS");
+    const char* durationEnv = getenv("JUNIPER_HOST_DURATION_MS");
+    const char* virtualEnv = getenv("JUNIPER_HOST_VIRTUAL_CLOCK");
+    unsigned long long iterations = iterationsEnv ? strtoull(iterationsEnv, nullptr, 10) : 0;
+    uint64_t duration = durationEnv ? strtoull(durationEnv, nullptr, 10) * 1000 : 0;
+    if (virtualEnv != nullptr && strcmp(virtualEnv, "0") != 0) {
+        juniper_host::useVirtualClock(true);
+    }
+    const char* serialEnv = getenv("JUNIPER_HOST_SERIAL_OUT");
+    if (serialEnv != nullptr) {
+        int fd = open(serialEnv, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            Serial.useFd(fd);
+        }
+    }
+    const char* analogEnv = getenv("JUNIPER_HOST_ANALOG_IN");
+    if (analogEnv != nullptr) {
+        const char* separator = strchr(analogEnv, ':');
+        if (separator == nullptr || !juniper_host::loadWaveform((uint16_t) atoi(analogEnv), separator + 1)) {
+            fprintf(stderr, "juniper_host: cannot load JUNIPER_HOST_ANALOG_IN=%s\n", analogEnv);
+        }
+    }
+    const char* serialInEnv = getenv("JUNIPER_HOST_SERIAL_IN");
+    bool serialIn = false;
+    if (serialInEnv != nullptr) {
+        int fd = open(serialInEnv, O_RDONLY);
+        if (fd >= 0) {
+            Serial.useInputFd(fd);
+            serialIn = true;
+        }
+    }
+#ifdef JUNIPER_H
+    juniper::power::wait_hook = juniper_host::idleWait;
+#endif
+    setup();
+    for (unsigned long long i = 0; iterations == 0 || i < iterations; i++) {
+        if (duration != 0 && juniper_host::clockMicros() >= duration) {
+            break;
+        }
+        if (serialIn && Serial.inputDone()) {
+            break;
+        }
+        loop();
+#ifdef JUNIPER_H
+        if (juniper_host::virtualClock) {
+            juniper_host::fastForward();
+        }
+#endif
+    }
+#ifdef JUNIPER_H
+    juniper_host::drainSerial();
+#endif
+    Serial.flush();
+    if (serialIn) {
+        uint64_t elapsed = juniper_host::clockMicros();
+        fprintf(stderr, "juniper_host: read %llu serial bytes in %.3f ms (%.0f bytes/s)\n",
+            (unsigned long long) Serial.bytesRead(), elapsed / 1000.0,
+            elapsed == 0 ? 0.0 : Serial.bytesRead() * 1e6 / elapsed);
+    }
+#ifdef JUNIPER_H
+    juniper_host::reportIdle();
+    juniper_host::reportProbe();
+    juniper_host::reportPorts();
+#endif
+    return 0;
+}
+#endif
+
+#endif
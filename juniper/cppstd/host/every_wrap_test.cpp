@@ -0,0 +1,68 @@
+// Checks the firing test of Time:every once millis() has passed 2^31, when a
+// plain wraparound safe comparison against an unset timestamp of 0 would say
+// the timer already fired. Build and run on the host with:
+//
+//     g++ -std=c++11 -I juniper/cppstd -I juniper/cppstd/host juniper/cppstd/host/every_wrap_test.cpp -o every_wrap_test -lpthread
+//     ./every_wrap_test
+//
+// The virtual clock is started just past 2^31 milliseconds and the timer is
+// driven the way Time:every drives it.
+
+#define JUNIPER_HOST_NO_MAIN
+
+#include "juniper.hpp"
+#include "Arduino.h"
+
+void setup() { }
+void loop() { }
+
+namespace {
+    const uint32_t interval = 1000;
+    uint32_t last_pulse = 0;
+    bool fired = false;
+
+    // One evaluation of Time:every at the current time.
+    bool every() {
+        uint32_t t = millis();
+        uint32_t last_window = (t / interval) * interval;
+        if (!juniper::every_due(last_window, last_pulse, fired)) {
+            return false;
+        }
+        last_pulse = t;
+        fired = true;
+        return true;
+    }
+
+    uint32_t failures = 0;
+
+    void check(bool ok, const char* what) {
+        if (!ok) {
+            printf("FAIL: %s\n", what);
+            failures++;
+        }
+    }
+}
+
+int main() {
+    juniper_host::useVirtualClock(true);
+    // Half way through the first whole window after 2^31 = 2147483648.
+    juniper_host::virtualMicros = (uint64_t) 2147484500u * 1000;
+
+    check(every(), "a timer first evaluated after 2^31 ms fires");
+    check(!every(), "it fires once per window");
+    delay(400);
+    check(!every(), "it stays quiet for the rest of the window");
+    delay(200);
+    check(every(), "it fires in the next window");
+
+    // The first window after start up is skipped, as before.
+    last_pulse = 0;
+    fired = false;
+    juniper_host::virtualMicros = 500 * 1000;
+    check(!every(), "a new timer waits for the end of the first window");
+    delay(600);
+    check(every(), "and then fires");
+
+    printf("%s\n", failures == 0 ? "ok" : "failed");
+    return failures == 0 ? 0 : 1;
+}
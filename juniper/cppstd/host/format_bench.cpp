@@ -0,0 +1,203 @@
+// Compares the juniper::format kernels used by the Io print functions with
+// the number printing of the Arduino core. Build and run on the host with:
+//
+//     g++ -std=c++11 -Os -I juniper/cppstd -I juniper/cppstd/host juniper/cppstd/host/format_bench.cpp -o format_bench -lpthread
+//     ./format_bench
+//
+// The Arduino side follows Print::printNumber and Print::printFloat: one
+// division per digit, and one float multiply per decimal place. Both sides
+// write into memory, so only the formatting is measured. -Os matches the
+// Arduino build.
+//
+// Every result is also compared exactly with the Arduino output and with
+// the correctly rounded output of snprintf. Per case the bench reports how
+// many strings differ between the two sides, how many of each side are off
+// from snprintf, and the first difference found. The integer cases must
+// always agree. The float cases do not: Arduino adds the rounding term
+// 0.5 / 10^places to the whole float before splitting it, which loses the
+// low bits of large values, so it can round up where the value rounds down
+// (94056.3828 prints as "94056.39" through Print and as "94056.38" through
+// juniper). juniper::format rounds the fraction on its own and is off far
+// less often, but not never, since it still works in float.
+
+#define JUNIPER_HOST_NO_MAIN
+
+#include "juniper.hpp"
+#include "Arduino.h"
+
+void setup() { }
+void loop() { }
+
+namespace arduino {
+    uint8_t printNumber(char* out, unsigned long n, uint8_t base) {
+        char buf[8 * sizeof(long) + 1];
+        char* str = &buf[sizeof(buf) - 1];
+        *str = '\0';
+        if (base < 2) {
+            base = 10;
+        }
+        do {
+            char c = n % base;
+            n /= base;
+            *--str = c < 10 ? c + '0' : c + 'A' - 10;
+        } while (n);
+        uint8_t length = (uint8_t) (&buf[sizeof(buf) - 1] - str);
+        memcpy(out, str, length + 1);
+        return length;
+    }
+
+    uint8_t printInt(char* out, long n, int base) {
+        if (base == 10 && n < 0) {
+            out[0] = '-';
+            return 1 + printNumber(out + 1, 0UL - (unsigned long) n, 10);
+        }
+        return printNumber(out, (uint32_t) n, base);
+    }
+
+    uint8_t printFloat(char* out, float number, uint8_t digits) {
+        if (isnan(number)) { strcpy(out, "nan"); return 3; }
+        if (isinf(number)) { strcpy(out, "inf"); return 3; }
+        if (number > 4294967040.0 || number < -4294967040.0) { strcpy(out, "ovf"); return 3; }
+        uint8_t n = 0;
+        if (number < 0.0) {
+            out[n++] = '-';
+            number = -number;
+        }
+        float rounding = 0.5;
+        for (uint8_t i = 0; i < digits; ++i) {
+            rounding /= 10.0f;
+        }
+        number += rounding;
+        unsigned long int_part = (unsigned long) number;
+        float remainder = number - (float) int_part;
+        n += printNumber(out + n, int_part, 10);
+        if (digits > 0) {
+            out[n++] = '.';
+        }
+        while (digits-- > 0) {
+            remainder *= 10.0f;
+            unsigned int to_print = (unsigned int) remainder;
+            out[n++] = (char) ('0' + to_print);
+            remainder -= to_print;
+        }
+        out[n] = '\0';
+        return n;
+    }
+}
+
+namespace {
+    uint32_t state = 12345;
+
+    uint32_t next() {
+        state = state * 1664525u + 1013904223u;
+        return state;
+    }
+
+    // Counts, for one case, the results that differ between the two sides
+    // and those that differ from the correctly rounded output of snprintf.
+    struct checker {
+        const char* name;
+        uint32_t mismatches;
+        uint32_t arduino_wrong;
+        uint32_t juniper_wrong;
+        char expected[64];
+        char actual[64];
+
+        checker(const char* n) : name(n), mismatches(0), arduino_wrong(0), juniper_wrong(0) { }
+
+        void check(const char* exact, const char* e, const char* a) {
+            arduino_wrong += strcmp(exact, e) != 0;
+            juniper_wrong += strcmp(exact, a) != 0;
+            if (strcmp(e, a) != 0) {
+                if (mismatches == 0) {
+                    strcpy(expected, e);
+                    strcpy(actual, a);
+                }
+                mismatches++;
+            }
+        }
+
+        void report() {
+            printf("%-16s %10u %10u %10u", name, mismatches, arduino_wrong, juniper_wrong);
+            if (mismatches != 0) {
+                printf("   %s / %s", expected, actual);
+            }
+            printf("\n");
+        }
+    };
+
+    template<typename F>
+    double nanosPerCall(uint32_t count, F f) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < count; i++) {
+            f(i);
+        }
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() / count;
+    }
+}
+
+int main() {
+    const uint32_t count = 1000000;
+    int32_t* ints = new int32_t[count];
+    float* floats = new float[count];
+    for (uint32_t i = 0; i < count; i++) {
+        ints[i] = (int32_t) next() >> (next() % 32);
+        floats[i] = (float) (int32_t) next() / (float) (1 + next() % 100000);
+    }
+
+    checker checks[] = {
+        checker("int decimal"),
+        checker("int hexadecimal"),
+        checker("float 2 places"),
+        checker("float 6 places")
+    };
+    char exact[64];
+    char expected[64];
+    char actual[64];
+    for (uint32_t i = 0; i < count; i++) {
+        snprintf(exact, sizeof(exact), "%ld", (long) ints[i]);
+        arduino::printInt(expected, ints[i], 10);
+        juniper::format::format_int(actual, sizeof(actual), ints[i]);
+        checks[0].check(exact, expected, actual);
+        snprintf(exact, sizeof(exact), "%lX", (unsigned long) (uint32_t) ints[i]);
+        arduino::printInt(expected, ints[i], 16);
+        juniper::format::format_base(actual, sizeof(actual), ints[i], 16);
+        checks[1].check(exact, expected, actual);
+        snprintf(exact, sizeof(exact), "%.2f", (double) floats[i]);
+        arduino::printFloat(expected, floats[i], 2);
+        juniper::format::format_float(actual, sizeof(actual), floats[i], 2);
+        checks[2].check(exact, expected, actual);
+        snprintf(exact, sizeof(exact), "%.6f", (double) floats[i]);
+        arduino::printFloat(expected, floats[i], 6);
+        juniper::format::format_float(actual, sizeof(actual), floats[i], 6);
+        checks[3].check(exact, expected, actual);
+    }
+    printf("%u values per case\n", count);
+    printf("%-16s %10s %10s %10s   %s\n", "", "differ", "arduino", "juniper", "first difference");
+    printf("%-16s %10s %10s %10s   %s\n", "", "", "off", "off", "(arduino / juniper)");
+    for (uint8_t i = 0; i < 4; i++) {
+        checks[i].report();
+    }
+    printf("\n");
+
+    volatile uint32_t sink = 0;
+    char buf[64];
+    printf("%-16s %12s %12s\n", "", "arduino ns", "juniper ns");
+    printf("%-16s %12.1f %12.1f\n", "int decimal",
+        nanosPerCall(count, [&](uint32_t i) { sink += arduino::printInt(buf, ints[i], 10); }),
+        nanosPerCall(count, [&](uint32_t i) { sink += juniper::format::format_int(buf, sizeof(buf), ints[i]); }));
+    printf("%-16s %12.1f %12.1f\n", "int hexadecimal",
+        nanosPerCall(count, [&](uint32_t i) { sink += arduino::printInt(buf, ints[i], 16); }),
+        nanosPerCall(count, [&](uint32_t i) { sink += juniper::format::format_base(buf, sizeof(buf), ints[i], 16); }));
+    printf("%-16s %12.1f %12.1f\n", "float 2 places",
+        nanosPerCall(count, [&](uint32_t i) { sink += arduino::printFloat(buf, floats[i], 2); }),
+        nanosPerCall(count, [&](uint32_t i) { sink += juniper::format::format_float(buf, sizeof(buf), floats[i], 2); }));
+    printf("%-16s %12.1f %12.1f\n", "float 6 places",
+        nanosPerCall(count, [&](uint32_t i) { sink += arduino::printFloat(buf, floats[i], 6); }),
+        nanosPerCall(count, [&](uint32_t i) { sink += juniper::format::format_float(buf, sizeof(buf), floats[i], 6); }));
+
+    delete[] ints;
+    delete[] floats;
+    return 0;
+}
@@ -0,0 +1,67 @@
+// Checks that buffered serial output never writes more than the port's
+// transmit buffer has room for. Build and run on the host with:
+//
+//     g++ -std=c++11 -I juniper/cppstd -I juniper/cppstd/host juniper/cppstd/host/serial_out_test.cpp -o serial_out_test -lpthread
+//     ./serial_out_test
+//
+// The fake port below accepts a fixed number of bytes per flush and fails
+// the test if a byte arrives while it is full, which on hardware would make
+// Serial.write wait for the UART.
+
+#define JUNIPER_HOST_NO_MAIN
+
+#include "juniper.hpp"
+#include "Arduino.h"
+
+void setup() { }
+void loop() { }
+
+namespace {
+    int room = 0;
+    uint32_t sent = 0;
+    uint32_t blocked = 0;
+
+    void send(uint8_t) {
+        if (room == 0) {
+            blocked++;
+            return;
+        }
+        room--;
+        sent++;
+    }
+
+    int available() {
+        return room;
+    }
+
+    uint32_t failures = 0;
+
+    void check(bool ok, const char* what) {
+        if (!ok) {
+            printf("FAIL: %s\n", what);
+            failures++;
+        }
+    }
+}
+
+int main() {
+    juniper::serial_out::enable(juniper::serial_out::drop_newest, send, available);
+    for (int i = 0; i < 100; i++) {
+        juniper::serial_out::put((uint8_t) i);
+    }
+
+    room = 10;
+    check(juniper::serial_out::flush(64) == 10, "flush is capped by the transmit buffer");
+    check(juniper::serial_out::flush(64) == 0, "flush sends nothing while the port is full");
+
+    room = 64;
+    check(juniper::serial_out::flush(5) == 5, "flush is capped by the budget");
+
+    room = 1000;
+    check(juniper::serial_out::flush(1000) == 85, "flush sends the rest of the buffer");
+    check(sent == 100, "every byte is sent once");
+    check(blocked == 0, "no byte is written to a full port");
+
+    printf("%s\n", failures == 0 ? "ok" : "failed");
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,71 @@
+// Reports the layout of the junstd records as the compiler emits them: the
+// size of each record, the bytes taken by its members, and the size it would
+// have with its members declared largest first. Build it against a compiled
+// sketch and run it on the host with:
+//
+//     g++ -std=c++11 -I . -I juniper/cppstd/host juniper/cppstd/host/size_report.cpp -o size_report -lpthread
+//     ./size_report
+//
+// JUNIPER_SKETCH names the sketch to include and defaults to the one
+// build.sh writes. The compiler emits record members in declaration order,
+// so a record whose size is above its packed size has padding that a
+// different declaration order would remove. On the host uint32_t has the
+// same 4 byte alignment as on 32-bit boards, so the sizes match theirs; on
+// AVR every type has alignment 1 and no record has padding. Generic records
+// such as the Prelude tuples depend on their type arguments, so the ones
+// junstd keeps in state refs are listed with the arguments they are used
+// with.
+
+#define JUNIPER_HOST_NO_MAIN
+
+#ifndef JUNIPER_SKETCH
+#define JUNIPER_SKETCH "sketch/sketch.ino"
+#endif
+
+#include JUNIPER_SKETCH
+
+#define JUNIPER_MEMBER_SIZE(T, m) sizeof(((T*) nullptr)->m)
+
+namespace {
+    void report(const char* name, size_t size, size_t align, size_t members) {
+        size_t packed = (members + align - 1) / align * align;
+        printf("%-40s %5u %7u %6u\n", name, (unsigned) size, (unsigned) members, (unsigned) packed);
+    }
+}
+
+int main() {
+    typedef Prelude::tuple3<Prelude::maybe<uint16_t>, uint32_t, bool> debounce_state;
+    typedef Prelude::tuple2<uint32_t, Prelude::sig<uint16_t>> memo_state;
+
+    printf("%-40s %5s %7s %6s\n", "record", "bytes", "members", "packed");
+    report("Io:fastPin", sizeof(Io::fastPin), alignof(Io::fastPin),
+        JUNIPER_MEMBER_SIZE(Io::fastPin, reg) +
+        JUNIPER_MEMBER_SIZE(Io::fastPin, pin) +
+        JUNIPER_MEMBER_SIZE(Io::fastPin, mask));
+    report("Io:pinEvent", sizeof(Io::pinEvent), alignof(Io::pinEvent),
+        JUNIPER_MEMBER_SIZE(Io::pinEvent, state) +
+        JUNIPER_MEMBER_SIZE(Io::pinEvent, timestamp));
+    report("Button:buttonState", sizeof(Button::buttonState), alignof(Button::buttonState),
+        JUNIPER_MEMBER_SIZE(Button::buttonState, actualState) +
+        JUNIPER_MEMBER_SIZE(Button::buttonState, lastState) +
+        JUNIPER_MEMBER_SIZE(Button::buttonState, lastDebounceTime));
+    report("Time:timerState", sizeof(Time::timerState), alignof(Time::timerState),
+        JUNIPER_MEMBER_SIZE(Time::timerState, lastPulse) +
+        JUNIPER_MEMBER_SIZE(Time::timerState, fired));
+    report("Time:timerState64", sizeof(Time::timerState64), alignof(Time::timerState64),
+        JUNIPER_MEMBER_SIZE(Time::timerState64, nextPulse));
+    report("Time:timerGroup", sizeof(Time::timerGroup), alignof(Time::timerGroup),
+        JUNIPER_MEMBER_SIZE(Time::timerGroup, id));
+    report("Time:task", sizeof(Time::task), alignof(Time::task),
+        JUNIPER_MEMBER_SIZE(Time::task, wakeAt) +
+        JUNIPER_MEMBER_SIZE(Time::task, step) +
+        JUNIPER_MEMBER_SIZE(Time::task, waiting));
+    report("(maybe<uint16> * uint32 * bool) debounce", sizeof(debounce_state), alignof(debounce_state),
+        JUNIPER_MEMBER_SIZE(debounce_state, e1) +
+        JUNIPER_MEMBER_SIZE(debounce_state, e2) +
+        JUNIPER_MEMBER_SIZE(debounce_state, e3));
+    report("(uint32 * sig<uint16>) memo", sizeof(memo_state), alignof(memo_state),
+        JUNIPER_MEMBER_SIZE(memo_state, e1) +
+        JUNIPER_MEMBER_SIZE(memo_state, e2));
+    return 0;
+}
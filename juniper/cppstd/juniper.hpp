@@ -2,6 +2,19 @@
 #define JUNIPER_H
 
 #include <stdlib.h>
+#include <inttypes.h>
+
+#if defined(__AVR__)
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
+#define JUNIPER_FLASH PROGMEM
+#define JUNIPER_FLASH_READ(p) ((char) pgm_read_byte(p))
+#else
+#define JUNIPER_FLASH
+#define JUNIPER_FLASH_READ(p) (*(p))
+#endif
 
 namespace juniper
 {
@@ -239,6 +252,1477 @@ namespace juniper
         }
     };
 
+    // Access to values of nullary ADTs such as Io:pinState, Io:mode and
+    // Io:base. The compiler emits them as a tag byte plus a union of unused
+    // bytes, and builds and compares them through lambdas and a switch over
+    // the tag. The tag alone identifies the value, numbered in declaration
+    // order, so conversions on hot paths read and build it directly.
+    namespace nullary {
+        template<typename T>
+        inline uint8_t tag(const T& value) {
+            return value.tag;
+        }
+
+        // Value initialization zeroes the unused payload, which the generated
+        // operator== still compares.
+        template<typename T>
+        inline T make(uint8_t tag) {
+            T ret = T();
+            ret.tag = tag;
+            return ret;
+        }
+
+        template<typename T>
+        inline bool same(const T& a, const T& b) {
+            return a.tag == b.tag;
+        }
+    }
+
+    // Presence test for signals. A sig<a> is generated as a tag byte around
+    // a maybe<a>, which has its own tag, and pattern matches test both. sig
+    // has a single constructor, so only the inner tag says whether the
+    // signal holds a value.
+    namespace signals {
+        template<typename S>
+        inline bool present(const S& s) {
+            return s.signal.tag == 0;
+        }
+    }
+
+    // Low-power waiting for Time:idle. wait() sleeps until the next interrupt
+    // of any kind; the caller re-checks the clock after every wake up. Pin
+    // interrupts set woken so that the idle loop can return early. woken is
+    // cleared by begin_tick, before anything reads the event queues, so an
+    // interrupt that lands after the queues were drained is never lost. It
+    // is tested with interrupts masked: on AVR sei() delays interrupts by one
+    // instruction, so nothing can slip in between the test and sleep_cpu(),
+    // and on ARM wfi still wakes on an interrupt that is pending while
+    // PRIMASK is set. Builds which cannot sleep, such as the host
+    // simulation, install wait_hook.
+    namespace power {
+        typedef void (*wait_fn)(uint32_t deadline);
+
+        wait_fn wait_hook = nullptr;
+        volatile bool woken = false;
+        uint32_t idle_millis = 0;
+
+        inline void wait(uint32_t deadline) {
+            if (wait_hook != nullptr) {
+                wait_hook(deadline);
+                return;
+            }
+#if defined(__AVR__)
+            set_sleep_mode(SLEEP_MODE_IDLE);
+            cli();
+            if (!woken) {
+                sleep_enable();
+                sei();
+                sleep_cpu();
+                sleep_disable();
+            }
+            sei();
+#elif defined(__arm__)
+            __asm__ volatile ("cpsid i" ::: "memory");
+            if (!woken) {
+                __asm__ volatile ("wfi");
+            }
+            __asm__ volatile ("cpsie i" ::: "memory");
+#endif
+        }
+    }
+
+    // Single-producer/single-consumer ring buffer. The producer (typically an
+    // interrupt service routine) only ever writes head_ and the consumer only
+    // ever writes tail_, so no locking is required. The indices are free
+    // running bytes, which keeps every index update a single atomic store
+    // even on 8-bit targets. N must be a power of two no larger than 128.
+    template<typename T, size_t N>
+    class spsc_ring {
+        static_assert(N > 0 && N <= 128 && (N & (N - 1)) == 0, "spsc_ring capacity must be a power of two no larger than 128");
+    public:
+        spsc_ring() : head_(0), tail_(0), dropped_(0) { }
+
+        bool push(const T& value) {
+            uint8_t head = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+            uint8_t tail = __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+            if ((uint8_t) (head - tail) == N) {
+                dropped_++;
+                return false;
+            }
+            data_[head & (N - 1)] = value;
+            __atomic_store_n(&head_, (uint8_t) (head + 1), __ATOMIC_RELEASE);
+            return true;
+        }
+
+        bool pop(T& out) {
+            uint8_t tail = __atomic_load_n(&tail_, __ATOMIC_RELAXED);
+            uint8_t head = __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+            if (head == tail) {
+                return false;
+            }
+            out = data_[tail & (N - 1)];
+            __atomic_store_n(&tail_, (uint8_t) (tail + 1), __ATOMIC_RELEASE);
+            return true;
+        }
+
+        uint8_t size() const {
+            return (uint8_t) (__atomic_load_n(&head_, __ATOMIC_ACQUIRE) - __atomic_load_n(&tail_, __ATOMIC_ACQUIRE));
+        }
+
+        bool empty() const { return size() == 0; }
+
+        // Number of values the producer had to discard because the ring was
+        // full. Only written by the producer.
+        uint32_t dropped() const { return dropped_; }
+
+    private:
+        T data_[N];
+        uint8_t head_;
+        uint8_t tail_;
+        volatile uint32_t dropped_;
+    };
+
+    struct pin_event {
+        uint32_t timestamp;
+        uint8_t value;
+    };
+
+    // Interrupt driven digital inputs. Each attached pin claims a slot which
+    // owns the event queue its ISR fills. attachInterrupt only accepts a plain
+    // function pointer, so the ISRs are trampolines templated on the slot
+    // index. The clock and pin reader are supplied by the caller, which keeps
+    // this header independent of the Arduino core.
+    //
+    // The slots are allocated up front, so their number and queue length are
+    // small by default. Build with JUNIPER_INTERRUPT_SLOTS and
+    // JUNIPER_INTERRUPT_QUEUE defined to change them; the queue length must
+    // be a power of two no larger than 128.
+    namespace pin_interrupts {
+#ifdef JUNIPER_INTERRUPT_SLOTS
+        const uint8_t max_slots = JUNIPER_INTERRUPT_SLOTS;
+#else
+        const uint8_t max_slots = 2;
+#endif
+#ifdef JUNIPER_INTERRUPT_QUEUE
+        const size_t queue_size = JUNIPER_INTERRUPT_QUEUE;
+#else
+        const size_t queue_size = 8;
+#endif
+
+        // The edges which trigger a slot's interrupt.
+        enum edge : uint8_t {
+            edge_rising = 0,
+            edge_falling = 1,
+            edge_change = 2
+        };
+
+        typedef uint32_t (*clock_fn)();
+        typedef uint8_t (*read_fn)(uint16_t);
+        typedef void (*isr_fn)();
+
+        struct slot {
+            bool attached;
+            edge mode;
+            uint16_t pin;
+            spsc_ring<pin_event, queue_size> events;
+        };
+
+        slot slots[max_slots];
+        clock_fn clock = nullptr;
+        read_fn read = nullptr;
+
+        // A rising or falling edge implies the new level. Reading the pin
+        // instead would see the level when the ISR runs, which for a pulse
+        // shorter than the interrupt latency is already the old one again.
+        // Only a change interrupt has to read the pin.
+        template<uint8_t Slot>
+        void isr() {
+            pin_event e;
+            e.timestamp = clock();
+            switch (slots[Slot].mode) {
+            case edge_rising:
+                e.value = 1;
+                break;
+            case edge_falling:
+                e.value = 0;
+                break;
+            default:
+                e.value = read(slots[Slot].pin);
+                break;
+            }
+            slots[Slot].events.push(e);
+            power::woken = true;
+        }
+
+        template<uint8_t Slot>
+        isr_fn isr_at(uint8_t i) {
+            return i == Slot ? &isr<Slot> : isr_at<Slot + 1>(i);
+        }
+
+        template<>
+        isr_fn isr_at<max_slots>(uint8_t) {
+            return nullptr;
+        }
+
+        slot* find(uint16_t pin) {
+            for (uint8_t i = 0; i < max_slots; i++) {
+                if (slots[i].attached && slots[i].pin == pin) {
+                    return &slots[i];
+                }
+            }
+            return nullptr;
+        }
+
+        // Claims a free slot for the pin and returns the ISR to attach, or
+        // nullptr if every slot is taken.
+        isr_fn claim(uint16_t pin, edge mode, clock_fn c, read_fn r) {
+            clock = c;
+            read = r;
+            for (uint8_t i = 0; i < max_slots; i++) {
+                if (!slots[i].attached) {
+                    slots[i].pin = pin;
+                    slots[i].mode = mode;
+                    slots[i].attached = true;
+                    return isr_at<0>(i);
+                }
+            }
+            return nullptr;
+        }
+
+        bool poll(uint16_t pin, pin_event& out) {
+            slot* s = find(pin);
+            return s != nullptr && s->events.pop(out);
+        }
+    }
+
+    // Digital pins resolved once to their port output register and bit mask,
+    // so that reads and writes skip the pin table lookups and PWM timer check
+    // done by digitalWrite and digitalRead. The register tables belong to the
+    // Arduino core, so the resolve macros are only expanded in module code.
+    // Only AVR has real registers. Builds without them, such as the host
+    // simulation, can install the hooks below; otherwise the mask is 0 and
+    // callers fall back to the Arduino functions. The fast path does not turn
+    // off PWM, so a pin driven with analogWrite must be written normally once
+    // first.
+#if defined(__AVR__)
+#define JUNIPER_PIN_REGISTER(pin) \
+    (digitalPinToPort(pin) == NOT_A_PIN ? 0 : (uint32_t) (uintptr_t) portOutputRegister(digitalPinToPort(pin)))
+#define JUNIPER_PIN_MASK(pin) \
+    (digitalPinToPort(pin) == NOT_A_PIN ? 0 : digitalPinToBitMask(pin))
+#else
+#define JUNIPER_PIN_REGISTER(pin) juniper::fast_io::hooked_register(pin)
+#define JUNIPER_PIN_MASK(pin) juniper::fast_io::hooked_mask(pin)
+#endif
+    namespace fast_io {
+        const uint8_t max_batch_ports = 8;
+
+#if !defined(__AVR__)
+        struct hooks {
+            uint32_t (*resolve_register)(uint16_t pin);
+            uint8_t (*resolve_mask)(uint16_t pin);
+            void (*write_port)(uint32_t reg, uint8_t set, uint8_t clear);
+            uint8_t (*read_port)(uint32_t reg);
+        };
+
+        hooks* port_hooks = nullptr;
+
+        inline uint32_t hooked_register(uint16_t pin) {
+            return port_hooks != nullptr ? port_hooks->resolve_register(pin) : 0;
+        }
+
+        inline uint8_t hooked_mask(uint16_t pin) {
+            return port_hooks != nullptr ? port_hooks->resolve_mask(pin) : 0;
+        }
+#endif
+
+        // Sets the set bits and clears the clear bits of a port in a single
+        // read-modify-write. Interrupts are masked around it, so an ISR
+        // writing another pin on the same port cannot lose its update.
+        inline void write_port(uint32_t reg, uint8_t set, uint8_t clear) {
+#if defined(__AVR__)
+            volatile uint8_t* out = (volatile uint8_t*) (uintptr_t) reg;
+            uint8_t sreg = SREG;
+            cli();
+            *out = (uint8_t) ((*out & ~clear) | set);
+            SREG = sreg;
+#else
+            port_hooks->write_port(reg, set, clear);
+#endif
+        }
+
+        // Reads the input levels of every pin on a port. On AVR the input
+        // register PINx sits two addresses below PORTx.
+        inline uint8_t read_port(uint32_t reg) {
+#if defined(__AVR__)
+            return *((volatile uint8_t*) (uintptr_t) reg - 2);
+#else
+            return port_hooks->read_port(reg);
+#endif
+        }
+
+        inline void write(uint32_t reg, uint8_t mask, bool high) {
+            write_port(reg, high ? mask : 0, high ? 0 : mask);
+        }
+
+        inline bool read(uint32_t reg, uint8_t mask) {
+            return (read_port(reg) & mask) != 0;
+        }
+
+        // Writes bit i of state to pin i of a list of resolved pins. Pins are
+        // grouped by port, so each port is written once no matter how many
+        // of its pins are in the list. Unresolved pins, and pins on ports
+        // beyond max_batch_ports, are written one at a time.
+        template<typename Pins>
+        void write_many(Pins& pins, uint32_t state, void (*fallback)(uint16_t pin, uint8_t value)) {
+            uint32_t regs[max_batch_ports];
+            uint8_t sets[max_batch_ports];
+            uint8_t clears[max_batch_ports];
+            uint8_t ports = 0;
+            for (uint32_t i = 0; i < pins.length && i < 32; i++) {
+                uint8_t high = (uint8_t) ((state >> i) & 1);
+                uint32_t reg = pins.data[i].reg;
+                uint8_t mask = pins.data[i].mask;
+                if (mask == 0) {
+                    fallback(pins.data[i].pin, high);
+                    continue;
+                }
+                uint8_t j = 0;
+                while (j < ports && regs[j] != reg) {
+                    j++;
+                }
+                if (j == max_batch_ports) {
+                    write(reg, mask, high);
+                    continue;
+                }
+                if (j == ports) {
+                    regs[j] = reg;
+                    sets[j] = 0;
+                    clears[j] = 0;
+                    ports++;
+                }
+                if (high) {
+                    sets[j] |= mask;
+                }
+                else {
+                    clears[j] |= mask;
+                }
+            }
+            for (uint8_t j = 0; j < ports; j++) {
+                write_port(regs[j], sets[j], clears[j]);
+            }
+        }
+
+        // Reads a list of resolved pins into a bit-packed word, reading each
+        // port once.
+        template<typename Pins>
+        uint32_t read_many(Pins& pins, uint8_t (*fallback)(uint16_t pin)) {
+            uint32_t regs[max_batch_ports];
+            uint8_t levels[max_batch_ports];
+            uint8_t ports = 0;
+            uint32_t state = 0;
+            for (uint32_t i = 0; i < pins.length && i < 32; i++) {
+                uint32_t reg = pins.data[i].reg;
+                uint8_t mask = pins.data[i].mask;
+                uint8_t level;
+                if (mask == 0) {
+                    level = fallback(pins.data[i].pin);
+                }
+                else {
+                    uint8_t j = 0;
+                    while (j < ports && regs[j] != reg) {
+                        j++;
+                    }
+                    if (j == max_batch_ports) {
+                        level = read(reg, mask);
+                    }
+                    else {
+                        if (j == ports) {
+                            regs[j] = reg;
+                            levels[j] = read_port(reg);
+                            ports++;
+                        }
+                        level = (levels[j] & mask) != 0;
+                    }
+                }
+                if (level) {
+                    state |= (uint32_t) 1 << i;
+                }
+            }
+            return state;
+        }
+    }
+
+    // Last value written to each output pin by Io:digOut and Io:anaOut, so
+    // that writes which would not change the pin are skipped. A pin is only
+    // trusted after it has been written through the table; direct writes
+    // record their value, and fast or batched writes and pin mode changes
+    // forget it. Pins at or above max_pins are never skipped. Build with
+    // JUNIPER_SHADOW_PINS defined to change the size of the table.
+    namespace shadow {
+#ifdef JUNIPER_SHADOW_PINS
+        const uint16_t max_pins = JUNIPER_SHADOW_PINS;
+#else
+        const uint16_t max_pins = 72;
+#endif
+        const uint16_t mask_bytes = (max_pins + 7) / 8;
+
+        uint8_t digital_known[mask_bytes];
+        uint8_t digital_level[mask_bytes];
+        uint8_t analog_known[mask_bytes];
+        uint8_t analog_value[max_pins];
+        // Writes skipped and writes passed on to the hardware.
+        uint32_t hits = 0;
+        uint32_t misses = 0;
+
+        // Records a digital level and returns false if the pin already held it.
+        inline bool digital_changed(uint16_t pin, bool high) {
+            if (pin >= max_pins) {
+                return true;
+            }
+            uint8_t i = pin >> 3;
+            uint8_t bit = 1 << (pin & 7);
+            bool same = (digital_known[i] & bit) != 0 && ((digital_level[i] & bit) != 0) == high;
+            digital_known[i] |= bit;
+            analog_known[i] &= ~bit;
+            if (high) {
+                digital_level[i] |= bit;
+            }
+            else {
+                digital_level[i] &= ~bit;
+            }
+            return !same;
+        }
+
+        // Records a PWM value and returns false if the pin already held it.
+        inline bool analog_changed(uint16_t pin, uint8_t value) {
+            if (pin >= max_pins) {
+                return true;
+            }
+            uint8_t i = pin >> 3;
+            uint8_t bit = 1 << (pin & 7);
+            bool same = (analog_known[i] & bit) != 0 && analog_value[pin] == value;
+            analog_known[i] |= bit;
+            digital_known[i] &= ~bit;
+            analog_value[pin] = value;
+            return !same;
+        }
+
+        // True if the digital write must reach the hardware, counting the result.
+        inline bool write_digital(uint16_t pin, bool high) {
+            if (digital_changed(pin, high)) {
+                misses++;
+                return true;
+            }
+            hits++;
+            return false;
+        }
+
+        inline bool write_analog(uint16_t pin, uint8_t value) {
+            if (analog_changed(pin, value)) {
+                misses++;
+                return true;
+            }
+            hits++;
+            return false;
+        }
+
+        inline void forget(uint16_t pin) {
+            if (pin < max_pins) {
+                uint8_t bit = 1 << (pin & 7);
+                digital_known[pin >> 3] &= ~bit;
+                analog_known[pin >> 3] &= ~bit;
+            }
+        }
+
+        inline void forget_all() {
+            for (uint16_t i = 0; i < mask_bytes; i++) {
+                digital_known[i] = 0;
+                analog_known[i] = 0;
+            }
+        }
+
+        template<typename Out>
+        void report(Out& out) {
+            out.print("output writes: skipped=");
+            out.print((unsigned long) hits);
+            out.print(" written=");
+            out.print((unsigned long) misses);
+            out.print("\n");
+        }
+    }
+
+    // Allocation-free number formatting for the Io print functions and the
+    // CharList formatting functions. Decimal integers are converted two
+    // digits at a time through a table of digit pairs, which halves the
+    // number of divisions, and power of two bases only shift. Floats are
+    // printed as a scaled integer, so only one float multiply is needed
+    // however many places are asked for. Every function writes into a caller
+    // supplied buffer, adds a terminating zero and returns the length, or 0
+    // if the buffer is too small for the result.
+    namespace format {
+        // The widest results: "-2147483648", 32 binary digits, and an int
+        // part, point and 9 places.
+        const uint8_t int_size = 12;
+        const uint8_t base_size = 33;
+        const uint8_t float_size = 22;
+        const uint8_t max_places = 9;
+
+        const char digit_pairs[201] JUNIPER_FLASH =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        const uint32_t powers_of_10[max_places + 1] = {
+            1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+        };
+
+        inline uint8_t copy_out(char* out, uint32_t size, const char* digits, uint8_t length) {
+            if (length >= size) {
+                if (size > 0) {
+                    out[0] = '\0';
+                }
+                return 0;
+            }
+            for (uint8_t i = 0; i < length; i++) {
+                out[i] = digits[i];
+            }
+            out[length] = '\0';
+            return length;
+        }
+
+        // Writes the decimal digits of v backwards, ending just before end,
+        // and returns a pointer to the first digit.
+        inline char* decimal_digits(uint32_t v, char* end) {
+            while (v >= 100) {
+                uint32_t q = v / 100;
+                uint8_t pair = (uint8_t) (v - q * 100) * 2;
+                *--end = JUNIPER_FLASH_READ(&digit_pairs[pair + 1]);
+                *--end = JUNIPER_FLASH_READ(&digit_pairs[pair]);
+                v = q;
+            }
+            if (v >= 10) {
+                uint8_t pair = (uint8_t) v * 2;
+                *--end = JUNIPER_FLASH_READ(&digit_pairs[pair + 1]);
+                *--end = JUNIPER_FLASH_READ(&digit_pairs[pair]);
+            }
+            else {
+                *--end = (char) ('0' + v);
+            }
+            return end;
+        }
+
+        inline uint8_t format_uint(char* out, uint32_t size, uint32_t v) {
+            char digits[int_size];
+            char* end = digits + int_size;
+            char* begin = decimal_digits(v, end);
+            return copy_out(out, size, begin, (uint8_t) (end - begin));
+        }
+
+        inline uint8_t format_int(char* out, uint32_t size, int32_t v) {
+            char digits[int_size];
+            char* end = digits + int_size;
+            char* begin = decimal_digits(v < 0 ? 0u - (uint32_t) v : (uint32_t) v, end);
+            if (v < 0) {
+                *--begin = '-';
+            }
+            return copy_out(out, size, begin, (uint8_t) (end - begin));
+        }
+
+        // Like Arduino's print(n, base), bases other than 10 print the bits
+        // of v as an unsigned number.
+        inline uint8_t format_base(char* out, uint32_t size, int32_t v, uint8_t base) {
+            if (base == 10) {
+                return format_int(out, size, v);
+            }
+            if (base < 2 || base > 36) {
+                base = 10;
+            }
+            char digits[base_size];
+            char* end = digits + base_size;
+            char* begin = end;
+            uint32_t u = (uint32_t) v;
+            uint8_t shift = base == 2 ? 1 : base == 4 ? 2 : base == 8 ? 3 : base == 16 ? 4 : base == 32 ? 5 : 0;
+            do {
+                uint8_t digit;
+                if (shift != 0) {
+                    digit = (uint8_t) (u & (base - 1));
+                    u >>= shift;
+                }
+                else {
+                    uint32_t q = u / base;
+                    digit = (uint8_t) (u - q * base);
+                    u = q;
+                }
+                *--begin = (char) (digit < 10 ? '0' + digit : 'A' + digit - 10);
+            } while (u != 0);
+            return copy_out(out, size, begin, (uint8_t) (end - begin));
+        }
+
+        // Prints like Arduino's print(f, places): "nan", "inf" and "ovf"
+        // for values it cannot represent, and at most max_places places.
+        inline uint8_t format_float(char* out, uint32_t size, float f, uint8_t places) {
+            if (f != f) {
+                return copy_out(out, size, "nan", 3);
+            }
+            if (f > 4294967040.0f || f < -4294967040.0f) {
+                bool infinite = f > 3.4028235e38f || f < -3.4028235e38f;
+                return copy_out(out, size, infinite ? "inf" : "ovf", 3);
+            }
+            if (places > max_places) {
+                places = max_places;
+            }
+            char digits[float_size];
+            char* end = digits + float_size;
+            bool negative = f < 0;
+            if (negative) {
+                f = -f;
+            }
+            uint32_t whole = (uint32_t) f;
+            uint32_t scale = powers_of_10[places];
+            uint32_t fraction = (uint32_t) ((f - (float) whole) * (float) scale + 0.5f);
+            if (fraction >= scale) {
+                whole++;
+                fraction -= scale;
+            }
+            char* whole_end = end;
+            if (places > 0) {
+                whole_end = decimal_digits(fraction, end);
+                while (end - whole_end < places) {
+                    *--whole_end = '0';
+                }
+                *--whole_end = '.';
+            }
+            char* begin = decimal_digits(whole, whole_end);
+            if (negative) {
+                *--begin = '-';
+            }
+            return copy_out(out, size, begin, (uint8_t) (end - begin));
+        }
+    }
+
+    // Non-blocking serial output. Once enabled, the Io print functions append
+    // to this ring instead of writing to Serial, and Io:flushSerial moves a
+    // bounded number of bytes per tick to the port, so a burst of telemetry
+    // cannot stall loop() waiting for the UART. The overflow policy decides
+    // what happens when the ring is full. The port is reached through sink,
+    // supplied by the caller, which keeps this header independent of the
+    // Arduino core. Both ends run in loop(), so dropping the oldest byte from
+    // the producer side is safe.
+    namespace serial_out {
+        enum overflow : uint8_t {
+            // Discard the byte being written.
+            drop_newest = 0,
+            // Discard the oldest buffered byte to make room.
+            drop_oldest = 1,
+            // Write the oldest buffered byte to the port, which may block.
+            block = 2
+        };
+
+        const uint8_t capacity = 128;
+
+        bool enabled = false;
+        overflow policy = drop_newest;
+        void (*sink)(uint8_t b) = nullptr;
+        // Free space in the port's transmit buffer, as given by the core's
+        // availableForWrite, so that flush never waits for the port.
+        int (*room)() = nullptr;
+        spsc_ring<uint8_t, capacity> ring;
+        uint32_t dropped = 0;
+
+        inline void enable(overflow p, void (*s)(uint8_t b), int (*r)()) {
+            policy = p;
+            sink = s;
+            room = r;
+            enabled = true;
+        }
+
+        inline size_t put(uint8_t b) {
+            if (ring.size() == capacity) {
+                uint8_t oldest;
+                switch (policy) {
+                case drop_oldest:
+                    ring.pop(oldest);
+                    dropped++;
+                    break;
+                case block:
+                    ring.pop(oldest);
+                    sink(oldest);
+                    break;
+                default:
+                    dropped++;
+                    return 0;
+                }
+            }
+            ring.push(b);
+            return 1;
+        }
+
+        // Writes at most budget buffered bytes to the port, and no more than
+        // its transmit buffer has room for, and returns how many were written.
+        inline uint16_t flush(uint16_t budget) {
+            if (room != nullptr) {
+                int space = room();
+                if (space < budget) {
+                    budget = space > 0 ? (uint16_t) space : 0;
+                }
+            }
+            uint16_t written = 0;
+            uint8_t b;
+            while (written < budget && ring.pop(b)) {
+                sink(b);
+                written++;
+            }
+            return written;
+        }
+
+        // A Print that appends to the ring. Base is the Arduino core's Print
+        // class, which this header cannot name directly.
+        template<typename Base>
+        class ring_printer : public Base {
+        public:
+            using Base::write;
+
+            size_t write(uint8_t b) {
+                return put(b);
+            }
+
+            // Every byte is offered to the ring, so drops are counted even
+            // though Print stops at the first byte that is not written.
+            size_t write(const uint8_t* buffer, size_t size) {
+                size_t written = 0;
+                while (size-- > 0) {
+                    written += put(*buffer++);
+                }
+                return written;
+            }
+        };
+
+        template<typename Base>
+        Base& printer() {
+            static ring_printer<Base> instance;
+            return instance;
+        }
+
+        // The Print the Io functions write to: the ring if buffering is
+        // enabled, otherwise the port itself.
+        template<typename Base, typename Port>
+        Base& target(Port& port) {
+            if (enabled) {
+                return printer<Base>();
+            }
+            return port;
+        }
+    }
+
+    // Non-blocking serial input. The Arduino core already buffers received
+    // bytes in a ring filled by the receive interrupt; these helpers drain a
+    // bounded number of them per tick. Source is the serial port type of the
+    // Arduino core.
+    namespace serial_in {
+        // Bytes discarded because a line was longer than its buffer.
+        uint32_t dropped = 0;
+
+        // Appends at most budget bytes from source to a line, stopping after
+        // a line feed, and returns true if the line is complete. Carriage
+        // returns are skipped, the line is kept zero terminated, and bytes
+        // which do not fit are counted in dropped.
+        template<typename Source>
+        bool read_line(Source& source, uint8_t* line, uint32_t& length, uint32_t capacity, uint16_t budget) {
+            while (budget > 0 && source.available() > 0) {
+                int c = source.read();
+                budget--;
+                if (c < 0) {
+                    break;
+                }
+                if (c == '\n') {
+                    return true;
+                }
+                if (c == '\r') {
+                    continue;
+                }
+                if (length + 1 < capacity) {
+                    line[length++] = (uint8_t) c;
+                    line[length] = 0;
+                }
+                else {
+                    dropped++;
+                }
+            }
+            return false;
+        }
+    }
+
+    // Histogram of 32-bit samples in power of two buckets. Bucket 0 counts
+    // zeros and bucket b counts values in [2^(b-1), 2^b - 1], so the whole
+    // range fits in 33 counters with no division on the record path.
+    class log2_histogram {
+    public:
+        static const uint8_t num_buckets = 33;
+
+        log2_histogram() : total_(0), max_(0) {
+            for (uint8_t i = 0; i < num_buckets; i++) {
+                counts_[i] = 0;
+            }
+        }
+
+        static uint8_t bucket(uint32_t value) {
+            uint8_t b = 0;
+            while (value != 0) {
+                value >>= 1;
+                b++;
+            }
+            return b;
+        }
+
+        static uint32_t bucket_max(uint8_t b) {
+            return b == 0 ? 0 : (b >= 32 ? 0xFFFFFFFFu : ((uint32_t) 1 << b) - 1);
+        }
+
+        void record(uint32_t value) {
+            counts_[bucket(value)]++;
+            total_++;
+            if (value > max_) {
+                max_ = value;
+            }
+        }
+
+        // Upper bound of the bucket holding the given percentile, capped at
+        // the largest value recorded.
+        uint32_t percentile(uint8_t pct) const {
+            uint32_t rank = (uint32_t) (((uint64_t) total_ * pct + 99) / 100);
+            uint32_t seen = 0;
+            for (uint8_t b = 0; b < num_buckets; b++) {
+                seen += counts_[b];
+                if (seen >= rank && seen > 0) {
+                    uint32_t upper = bucket_max(b);
+                    return upper < max_ ? upper : max_;
+                }
+            }
+            return max_;
+        }
+
+        uint32_t count(uint8_t b) const { return counts_[b]; }
+        uint32_t total() const { return total_; }
+        uint32_t max() const { return max_; }
+
+        template<typename Out>
+        void report(Out& out, const char* name, const char* unit) const {
+            out.print(name);
+            out.print(": n=");
+            out.print((unsigned long) total_);
+            out.print(" max=");
+            out.print((unsigned long) max_);
+            out.print(unit);
+            out.print(" p99<=");
+            out.print((unsigned long) percentile(99));
+            out.print(unit);
+            out.print("\n");
+            for (uint8_t b = 0; b < num_buckets; b++) {
+                if (counts_[b] != 0) {
+                    out.print("  <=");
+                    out.print((unsigned long) bucket_max(b));
+                    out.print(unit);
+                    out.print(" ");
+                    out.print((unsigned long) counts_[b]);
+                    out.print("\n");
+                }
+            }
+        }
+
+    private:
+        uint32_t counts_[num_buckets];
+        uint32_t total_;
+        uint32_t max_;
+    };
+
+    // Opt-in timing probe. Build with JUNIPER_PROBE defined to record how
+    // long every loop iteration was busy and how late each periodic timer
+    // fires relative to its scheduled window. The busy time is the time from
+    // one tick to the next less the time spent sleeping in Time:idle, so a
+    // loop which idles until its next deadline does not look slow. Without
+    // JUNIPER_PROBE the histograms are not allocated, the hooks are empty and
+    // report writes nothing.
+    namespace probe {
+#ifdef JUNIPER_PROBE
+        const bool enabled = true;
+
+        log2_histogram loop_micros;
+        log2_histogram timer_lateness_millis;
+        uint32_t last_tick = 0;
+        uint32_t idle_micros = 0;
+        bool ticked = false;
+
+        inline void tick(uint32_t now_micros) {
+            if (ticked) {
+                loop_micros.record(now_micros - last_tick - idle_micros);
+            }
+            last_tick = now_micros;
+            idle_micros = 0;
+            ticked = true;
+        }
+
+        inline void idle(uint32_t micros) {
+            idle_micros += micros;
+        }
+
+        inline void timer_fired(uint32_t lateness_millis) {
+            timer_lateness_millis.record(lateness_millis);
+        }
+
+        template<typename Out>
+        void report(Out& out) {
+            loop_micros.report(out, "loop busy", "us");
+            timer_lateness_millis.report(out, "timer lateness", "ms");
+            shadow::report(out);
+        }
+#else
+        const bool enabled = false;
+
+        inline void tick(uint32_t) { }
+
+        inline void idle(uint32_t) { }
+
+        inline void timer_fired(uint32_t) { }
+
+        template<typename Out>
+        void report(Out& out) {
+            shadow::report(out);
+        }
+#endif
+    }
+
+    // Wraparound safe comparison of two 32-bit timestamps: true if a is at or
+    // after b, as long as they are less than half the counter range apart.
+    inline bool time_reached(uint32_t a, uint32_t b) {
+        return (int32_t) (a - b) >= 0;
+    }
+
+    // The firing test of Time:every: true if a timer which last fired at
+    // last_pulse has not yet fired in the window starting at last_window. A
+    // timer which has never fired has no last_pulse to compare, so it is due
+    // in every window but the first, however long the clock has been running.
+    inline bool every_due(uint32_t last_window, uint32_t last_pulse, bool fired) {
+        if (!fired) {
+            return last_window != 0;
+        }
+        return !time_reached(last_pulse, last_window);
+    }
+
+    // Extends a wrapping 32-bit hardware counter such as micros() to a 64-bit
+    // monotonic count. It must be sampled at least once per wrap period of the
+    // underlying counter (about 71 minutes for micros()).
+    class clock64 {
+    public:
+        clock64() : last_(0), high_(0) { }
+
+        uint64_t extend(uint32_t now) {
+            if (now < last_) {
+                high_++;
+            }
+            last_ = now;
+            return ((uint64_t) high_ << 32) | now;
+        }
+
+    private:
+        uint32_t last_;
+        uint32_t high_;
+    };
+
+    clock64 micros64;
+
+    // Time snapshot taken once at the top of each tick by Time:tick, so every
+    // node evaluated on that tick sees the same time and the hardware counter
+    // is read once. Until the first snapshot the clock is read directly.
+    namespace snapshot {
+        bool taken = false;
+        uint32_t millis_now = 0;
+        uint32_t micros_now = 0;
+        uint64_t micros64_now = 0;
+
+        inline void take(uint32_t ms, uint32_t us) {
+            millis_now = ms;
+            micros_now = us;
+            micros64_now = micros64.extend(us);
+            taken = true;
+        }
+
+        // Moves the snapshot to the current time after a wait, if one has
+        // been taken, without starting a new tick.
+        inline void refresh(uint32_t ms, uint32_t us) {
+            if (taken) {
+                take(ms, us);
+            }
+        }
+    }
+
+    // Earliest timer deadline reported during the current tick. Timers note
+    // their next deadline here, which tells the runtime how long nothing will
+    // happen: a host simulation can jump a virtual clock straight to it.
+    namespace deadlines {
+        bool pending = false;
+        uint32_t earliest = 0;
+
+        inline void note(uint32_t deadline) {
+            if (!pending || !time_reached(deadline, earliest)) {
+                earliest = deadline;
+                pending = true;
+            }
+        }
+
+        inline void reset() {
+            pending = false;
+        }
+    }
+
+    // Continuous ADC sampling at a fixed rate into a double buffer. While the
+    // interrupt side fills one buffer the other holds the last complete
+    // block for loop() to take. If loop() does not take a block before the
+    // next one completes, the older block is lost and counted in overruns.
+    //
+    // The interrupt driven path is opt-in: build with JUNIPER_ADC_SAMPLING
+    // defined to use it. Only then is ADC_vect defined here, so sketches and
+    // libraries with their own ADC interrupt still link, and the buffers are
+    // only kept by the linker when something samples. With it, on AVR the
+    // conversions are started by Timer1 compare match B, so the sample timing
+    // does not depend on loop() at all and loop() does not wait for
+    // conversions. startSampling then reconfigures Timer1 without checking
+    // who else uses it: PWM on pins 9 and 10 (11 and 12 on the Mega), the
+    // Servo library, and anything else driven by Timer1 stop working while
+    // sampling runs.
+    //
+    // Otherwise, and on all other boards, poll() takes the samples which are
+    // due on each tick with the supplied read function. This is a burst of
+    // blocking reads, not continuous sampling. A host simulation can install
+    // read_hook to supply the value at the scheduled time of each sample.
+    namespace adc {
+        const uint8_t max_block = 64;
+        const uint8_t no_block = 255;
+
+        typedef uint16_t (*read_fn)(uint16_t pin);
+        typedef uint16_t (*read_at_fn)(uint16_t pin, uint32_t at_micros);
+
+        read_at_fn read_hook = nullptr;
+
+        volatile uint16_t buffers[2][max_block];
+        volatile uint8_t block_size = max_block;
+        volatile uint8_t fill = 0;
+        volatile uint8_t write_buffer = 0;
+        volatile uint8_t ready = no_block;
+        volatile uint32_t overruns = 0;
+        bool running = false;
+
+        uint16_t pin = 0;
+        read_fn read = nullptr;
+        uint32_t period_micros = 0;
+        uint32_t next_sample = 0;
+
+        inline void sample(uint16_t value) {
+            uint8_t index = fill;
+            buffers[write_buffer][index] = value;
+            if (++index < block_size) {
+                fill = index;
+                return;
+            }
+            if (ready != no_block) {
+                overruns++;
+            }
+            ready = write_buffer;
+            write_buffer ^= 1;
+            fill = 0;
+        }
+
+#if defined(JUNIPER_ADC_SAMPLING) && defined(__AVR__) && defined(ADC_vect) && defined(OCF1B)
+        inline void start_hardware(uint8_t channel, uint32_t rate) {
+            static const uint16_t prescales[] = { 1, 8, 64, 256, 1024 };
+            uint32_t ticks = F_CPU / rate;
+            uint8_t select = 0;
+            while (select < 4 && ticks / prescales[select] > 65536) {
+                select++;
+            }
+            uint32_t top = ticks / prescales[select];
+            uint8_t sreg = SREG;
+            cli();
+            TCCR1A = 0;
+            TCCR1B = 0;
+            TCNT1 = 0;
+            OCR1A = (uint16_t) (top > 0 ? top - 1 : 0);
+            OCR1B = OCR1A;
+            TIFR1 = _BV(OCF1B);
+            // CTC mode with OCR1A as top; compare match B triggers the ADC.
+            TCCR1B = _BV(WGM12) | (select + 1);
+            ADMUX = _BV(REFS0) | (channel & 0x07);
+#if defined(MUX5)
+            ADCSRB = (channel & 0x08 ? _BV(MUX5) : 0) | _BV(ADTS2) | _BV(ADTS0);
+#else
+            ADCSRB = _BV(ADTS2) | _BV(ADTS0);
+#endif
+            ADCSRA = _BV(ADEN) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+            SREG = sreg;
+        }
+
+        inline void stop_hardware() {
+            ADCSRA &= (uint8_t) ~(_BV(ADATE) | _BV(ADIE));
+            TCCR1B = 0;
+        }
+#define JUNIPER_ADC_HARDWARE 1
+#else
+#define JUNIPER_ADC_HARDWARE 0
+#endif
+
+        // Starts sampling pin at rate samples per second in blocks of size
+        // samples. channel is the ADC input of the pin, used by the hardware
+        // path. read reads the pin once and now_micros is the current time,
+        // both used by the polled path.
+        inline void start(uint16_t p, uint8_t channel, uint32_t rate, uint8_t size,
+                          read_fn r, uint32_t now_micros) {
+            if (rate == 0) {
+                return;
+            }
+            block_size = size == 0 || size > max_block ? max_block : size;
+            fill = 0;
+            write_buffer = 0;
+            ready = no_block;
+            pin = p;
+            read = r;
+            period_micros = 1000000 / rate;
+            next_sample = now_micros + period_micros;
+            running = true;
+#if JUNIPER_ADC_HARDWARE
+            if (read_hook == nullptr) {
+                start_hardware(channel, rate);
+            }
+#else
+            (void) channel;
+#endif
+        }
+
+        inline void stop() {
+#if JUNIPER_ADC_HARDWARE
+            if (running && read_hook == nullptr) {
+                stop_hardware();
+            }
+#endif
+            running = false;
+        }
+
+        // Takes the samples which are due by now_micros on the polled path.
+        // At most two blocks are taken per call, so that a long stall cannot
+        // turn into an unbounded burst of reads.
+        inline void poll(uint32_t now_micros) {
+            if (!running || (JUNIPER_ADC_HARDWARE && read_hook == nullptr)) {
+                return;
+            }
+            uint16_t budget = 2 * block_size;
+            while (budget-- > 0 && time_reached(now_micros, next_sample)) {
+                sample(read_hook != nullptr ? read_hook(pin, next_sample) : read(pin));
+                next_sample += period_micros;
+            }
+            if (!time_reached(next_sample, now_micros)) {
+                next_sample = now_micros + period_micros;
+            }
+        }
+
+        // How long until the block being filled is complete, so that an idle
+        // loop or a virtual clock does not sleep past it.
+        inline uint32_t micros_until_block(uint32_t now_micros) {
+            uint32_t remaining = block_size - fill;
+            if (JUNIPER_ADC_HARDWARE && read_hook == nullptr) {
+                return remaining * period_micros;
+            }
+            uint32_t until_next = time_reached(now_micros, next_sample) ? 0 : next_sample - now_micros;
+            return until_next + (remaining - 1) * period_micros;
+        }
+
+        // Copies the last complete block into out, at most capacity samples,
+        // and returns whether there was one.
+        template<typename List>
+        bool take(List& out, uint32_t capacity) {
+#if defined(__AVR__)
+            uint8_t sreg = SREG;
+            cli();
+#endif
+            bool taken = ready != no_block;
+            if (taken) {
+                uint8_t count = block_size;
+                if (count > capacity) {
+                    count = (uint8_t) capacity;
+                }
+                for (uint8_t i = 0; i < count; i++) {
+                    out.data[i] = buffers[ready][i];
+                }
+                out.length = count;
+                ready = no_block;
+            }
+#if defined(__AVR__)
+            SREG = sreg;
+#endif
+            return taken;
+        }
+    }
+
+#if JUNIPER_ADC_HARDWARE
+    ISR(ADC_vect) {
+        TIFR1 = _BV(OCF1B);
+        juniper::adc::sample(ADC);
+    }
+#endif
+
+    // Scheduler for a group of periodic timers. Deadlines are kept in a binary
+    // min-heap of timer ids, so advancing the group costs O(k log n) for the k
+    // timers that are due rather than O(n), and the common path needs no
+    // division. Timers fire on multiples of their interval plus a phase
+    // offset. When the loop runs late, each timer's catch_up policy decides
+    // what happens to the windows it missed.
+    enum catch_up : uint8_t {
+        // Fire once and drop the missed windows.
+        catch_up_skip = 0,
+        // Fire once per tick until every missed window has been delivered.
+        catch_up_burst = 1,
+        // Fire once and report how many windows elapsed.
+        catch_up_coalesce = 2
+    };
+
+    class timer_group {
+    public:
+        static const uint8_t invalid_id = 255;
+
+        timer_group(uint8_t capacity)
+            : capacity_(capacity), size_(0), tick_(1), now_(0),
+              timers_(new timer[capacity]), heap_(new uint8_t[capacity]) { }
+
+        ~timer_group() {
+            delete[] timers_;
+            delete[] heap_;
+        }
+
+        // Registers a new timer which fires at phase + k * interval and
+        // returns its id, or invalid_id if the group is full.
+        uint8_t add(uint32_t interval, uint32_t now, uint32_t phase = 0,
+                    catch_up policy = catch_up_skip) {
+            if (size_ >= capacity_) {
+                return invalid_id;
+            }
+            uint8_t id = size_++;
+            timer& t = timers_[id];
+            t.interval = interval;
+            if (interval == 0) {
+                t.deadline = now;
+            }
+            else {
+                phase %= interval;
+                t.deadline = now < phase ? phase : ((now - phase) / interval + 1) * interval + phase;
+            }
+            t.fired_tick = 0;
+            t.periods = 0;
+            t.policy = policy;
+            heap_[id] = id;
+            sift_up(id);
+            return id;
+        }
+
+        // Takes the time snapshot for this tick and fires every timer whose
+        // deadline has been reached. Each timer fires at most once per tick;
+        // fired timers are popped to the back of the heap while the due ones
+        // are collected, then pushed back in with their new deadlines.
+        void advance(uint32_t now) {
+            tick_++;
+            now_ = now;
+            uint8_t due = size_;
+            while (due > 0 && time_reached(now, timers_[heap_[0]].deadline)) {
+                fire(timers_[heap_[0]], now);
+                due--;
+                juniper::swap(heap_[0], heap_[due]);
+                sift_down(0, due);
+            }
+            for (uint8_t i = due; i < size_; i++) {
+                sift_up(i);
+            }
+            if (size_ > 0) {
+                deadlines::note(next_deadline());
+            }
+        }
+
+        bool fired(uint8_t id) const {
+            return id < size_ && timers_[id].fired_tick == tick_;
+        }
+
+        // The number of periods the timer accounts for on this tick: 0 if it
+        // did not fire, more than 1 only for catch_up_coalesce timers.
+        uint32_t periods(uint8_t id) const {
+            return fired(id) ? timers_[id].periods : 0;
+        }
+
+        // How many windows the timer is still behind by. Only burst timers
+        // ever fall behind.
+        uint32_t backlog(uint8_t id) const {
+            if (id >= size_) {
+                return 0;
+            }
+            const timer& t = timers_[id];
+            if (t.interval == 0 || !time_reached(now_, t.deadline)) {
+                return 0;
+            }
+            return (now_ - t.deadline) / t.interval + 1;
+        }
+
+        uint32_t now() const { return now_; }
+
+        uint8_t size() const { return size_; }
+
+        // The earliest pending deadline. Only meaningful if size() > 0.
+        uint32_t next_deadline() const { return timers_[heap_[0]].deadline; }
+
+    private:
+        struct timer {
+            uint32_t interval;
+            uint32_t deadline;
+            uint32_t fired_tick;
+            uint32_t periods;
+            catch_up policy;
+        };
+
+        void fire(timer& t, uint32_t now) {
+            uint32_t late = now - t.deadline;
+            t.fired_tick = tick_;
+            probe::timer_fired(late);
+            if (t.interval == 0) {
+                t.periods = 1;
+                t.deadline = now + 1;
+                return;
+            }
+            // Only a late timer pays for the division.
+            uint32_t elapsed = late < t.interval ? 1 : late / t.interval + 1;
+            switch (t.policy) {
+            case catch_up_burst:
+                t.periods = 1;
+                t.deadline += t.interval;
+                break;
+            case catch_up_coalesce:
+                t.periods = elapsed;
+                t.deadline += elapsed * t.interval;
+                break;
+            default:
+                t.periods = 1;
+                t.deadline += elapsed * t.interval;
+                break;
+            }
+        }
+
+        // Heap positions are computed in 16 bits: a group can hold up to 254
+        // timers, and 2 * i + 2 does not fit in a byte past position 126.
+        bool before(uint16_t i, uint16_t j) const {
+            return !time_reached(timers_[heap_[i]].deadline, timers_[heap_[j]].deadline);
+        }
+
+        void sift_up(uint16_t i) {
+            while (i > 0) {
+                uint16_t parent = (i - 1) / 2;
+                if (!before(i, parent)) {
+                    break;
+                }
+                juniper::swap(heap_[i], heap_[parent]);
+                i = parent;
+            }
+        }
+
+        void sift_down(uint16_t i, uint16_t n) {
+            for (;;) {
+                uint16_t smallest = i;
+                uint16_t left = 2 * i + 1;
+                uint16_t right = left + 1;
+                if (left < n && before(left, smallest)) {
+                    smallest = left;
+                }
+                if (right < n && before(right, smallest)) {
+                    smallest = right;
+                }
+                if (smallest == i) {
+                    break;
+                }
+                juniper::swap(heap_[i], heap_[smallest]);
+                i = smallest;
+            }
+        }
+
+        uint8_t capacity_;
+        uint8_t size_;
+        uint32_t tick_;
+        uint32_t now_;
+        timer* timers_;
+        uint8_t* heap_;
+    };
+
+    // The timer groups created by Time:makeGroup. Juniper code refers to a
+    // group by its index here, so it never holds a pointer, and begin_tick
+    // advances every group. Groups live for the whole program. Build with
+    // JUNIPER_TIMER_GROUPS defined to allow more than the default number.
+    namespace timer_groups {
+#ifdef JUNIPER_TIMER_GROUPS
+        const uint8_t max_groups = JUNIPER_TIMER_GROUPS;
+#else
+        const uint8_t max_groups = 2;
+#endif
+        const uint8_t invalid_group = 255;
+
+        timer_group* groups[max_groups];
+        uint8_t count = 0;
+
+        // Creates a group and returns its index, or invalid_group if
+        // max_groups groups already exist.
+        inline uint8_t make(uint8_t capacity) {
+            if (count >= max_groups) {
+                return invalid_group;
+            }
+            groups[count] = new timer_group(capacity);
+            return count++;
+        }
+
+        inline uint8_t add(uint8_t group, uint32_t interval, uint32_t now,
+                           uint32_t phase, catch_up policy) {
+            return group < count ? groups[group]->add(interval, now, phase, policy) : timer_group::invalid_id;
+        }
+
+        inline bool fired(uint8_t group, uint8_t id) {
+            return group < count && groups[group]->fired(id);
+        }
+
+        inline uint32_t periods(uint8_t group, uint8_t id) {
+            return group < count ? groups[group]->periods(id) : 0;
+        }
+
+        inline uint32_t now(uint8_t group) {
+            return group < count ? groups[group]->now() : 0;
+        }
+
+        inline void advance(uint32_t now) {
+            for (uint8_t i = 0; i < count; i++) {
+                groups[i]->advance(now);
+            }
+        }
+    }
+
+    // The number of the current tick of the main loop, advanced by
+    // Time:tick. It stays zero until the first tick.
+    uint32_t tick_count = 0;
+
+    // Everything Time:tick does at the top of loop(): re-arms power::woken,
+    // takes the time snapshot, starts a new tick for memoized signals, marks
+    // the tick for the probe and fires the due timers of every timer group.
+    inline void begin_tick(uint32_t ms, uint32_t us) {
+        power::woken = false;
+        snapshot::take(ms, us);
+        tick_count++;
+        probe::tick(us);
+        timer_groups::advance(ms);
+    }
+
     template<typename T>
     T quit() {
         exit(1);